@@ -0,0 +1,691 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <flat_map>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "cpp-sort/sorters/drop_merge_sorter.h"
+#include "cpp-sort/sorters/pdq_sorter.h"
+#include "cpp-sort/sorters/verge_sorter.h"
+
+/**
+ * @brief キー列の順に値列を走査するためのヘッダオンリーライブラリ
+ *
+ * sort_by_key(keys, values, visitor) はキーの順に visitor(key, value) を呼び出す。
+ * 同じキーが複数ある場合はすべて呼び出す(同値キー間の順序は不定)。
+ * 実装はキー型でコンパイル時に、要素数と入力の並び方で実行時に選択する。
+ * 実行時の選択基準はベンチマークのキャリブレーション結果(calibration)から与える。
+ */
+namespace sort_by_map {
+
+/*===============================================================================*\
+ * キーの比較
+\*===============================================================================*/
+
+/**
+ * @brief IEEE 754のtotalOrderによる浮動小数点数の比較
+ *
+ * operator<ではNaNが狭義の弱順序を満たさないため、std::strong_orderを使う。
+ * -NaN < -inf < ... < -0.0 < +0.0 < ... < +inf < +NaN の順になる。
+ */
+struct total_order_less {
+  template<std::floating_point T>
+  bool operator()(T lhs, T rhs) const noexcept {
+    return std::strong_order(lhs, rhs) < 0;
+  }
+};
+
+// キー型ごとの比較関数
+template<typename Key>
+struct key_order {
+  using type = std::less<>;
+};
+
+template<std::floating_point Key>
+struct key_order<Key> {
+  using type = total_order_less;
+};
+
+template<typename Key>
+using key_less = typename key_order<Key>::type;
+
+// doubleをtotalOrderの順序を保った符号なし整数に変換する
+constexpr std::uint64_t total_order_bits(double value) noexcept {
+  auto const bits = std::bit_cast<std::uint64_t>(value);
+  constexpr auto sign = std::uint64_t{1} << 63;
+  return (bits & sign) ? ~bits : (bits | sign);
+}
+
+/*===============================================================================*\
+ * キー型の分類 (コンパイル時の分岐に使う)
+\*===============================================================================*/
+
+enum class key_category {
+  int32,      // 32bit以下の符号付き整数
+  int64,      // それ以外の整数
+  floating,   // float, double
+  string,     // std::string, std::string_view
+  composite,  // 先頭要素が整数のstd::tuple
+  other,
+};
+
+template<typename>
+struct is_integral_prefixed_tuple : std::false_type {};
+
+template<typename Head, typename... Tail>
+struct is_integral_prefixed_tuple<std::tuple<Head, Tail...>> : std::bool_constant<std::is_integral_v<Head>> {};
+
+// char const*などはstd::less<>でアドレスを比べるので、文字列の内容で並べてよいのは標準の文字列型だけ
+template<typename>
+struct is_std_string : std::false_type {};
+
+template<typename Allocator>
+struct is_std_string<std::basic_string<char, std::char_traits<char>, Allocator>> : std::true_type {};
+
+template<>
+struct is_std_string<std::string_view> : std::true_type {};
+
+template<typename Key>
+constexpr key_category key_category_of() noexcept {
+  if constexpr (std::is_integral_v<Key> && std::is_signed_v<Key> && sizeof(Key) <= sizeof(std::int32_t)) {
+    return key_category::int32;
+  } else if constexpr (std::is_integral_v<Key>) {
+    return key_category::int64;
+  } else if constexpr (std::is_same_v<Key, float> || std::is_same_v<Key, double>) {
+    return key_category::floating;
+  } else if constexpr (is_std_string<Key>::value) {
+    return key_category::string;
+  } else if constexpr (is_integral_prefixed_tuple<Key>::value) {
+    return key_category::composite;
+  } else {
+    return key_category::other;
+  }
+}
+
+template<typename Key>
+inline constexpr key_category key_category_v = key_category_of<Key>();
+
+static_assert(key_category_v<std::string> == key_category::string);
+static_assert(key_category_v<std::string_view> == key_category::string);
+static_assert(key_category_v<char const*> == key_category::other);
+
+/*===============================================================================*\
+ * 入力の並び方
+\*===============================================================================*/
+
+enum class input_shape {
+  random,         // 特に偏りがない
+  nearly_sorted,  // ほぼ昇順
+  descending,     // ほぼ降順
+};
+
+/**
+ * @brief 隣接要素の昇順・降順の数から入力の並び方を推定する
+ *
+ * O(n)の比較で済む。等しい隣接要素はどちらにも数えないので、重複の多いキーでも判定できる。
+ * 降順の組が1/8以下ならほぼ昇順、昇順の組が1/8以下ならほぼ降順とみなす。
+ * 重複が多いと両方が1/8以下になり得るので、そのときは少ない方で決める(同数ならほぼ昇順)。
+ */
+template<typename Key>
+input_shape detect_shape(std::span<Key const> keys) {
+  if (keys.size() < 2) {
+    return input_shape::nearly_sorted;
+  }
+
+  auto const compare = key_less<Key>{};
+  auto ascents = std::size_t{0};
+  auto descents = std::size_t{0};
+  for (auto idx = std::size_t{1}; idx < keys.size(); ++idx) {
+    ascents += compare(keys[idx - 1], keys[idx]) ? 1 : 0;
+    descents += compare(keys[idx], keys[idx - 1]) ? 1 : 0;
+  }
+
+  auto const tolerance = (keys.size() - 1) / 8;
+  if (descents <= tolerance and descents <= ascents) {
+    return input_shape::nearly_sorted;
+  }
+  if (ascents <= tolerance) {
+    return input_shape::descending;
+  }
+  return input_shape::random;
+}
+
+/*===============================================================================*\
+ * 小さいNに特化したソート
+\*===============================================================================*/
+
+// 小さいN向けのソートで扱う最大要素数 (インデックスをuint8_tで持てる範囲)
+inline constexpr std::size_t small_sort_max = 128;
+
+// ソーティングネットワークで扱う最大要素数
+inline constexpr std::size_t sorting_network_max = 32;
+
+/**
+ * @brief Batcherのmerge exchange (Knuth Algorithm 5.2.2M) の比較器を列挙する
+ *
+ * 2のべき乗でないnにもそのまま適用できる。
+ */
+template<typename Visitor>
+constexpr void for_each_merge_exchange(std::size_t n, Visitor&& visit) {
+  if (n < 2) {
+    return;
+  }
+  auto const t = static_cast<std::size_t>(std::bit_width(n - 1));
+  for (auto p = std::size_t{1} << (t - 1); p > 0; p /= 2) {
+    auto q = std::size_t{1} << (t - 1);
+    auto r = std::size_t{0};
+    auto d = p;
+    while (true) {
+      for (auto i = std::size_t{0}; i + d < n; ++i) {
+        if ((i & p) == r) {
+          visit(i, i + d);
+        }
+      }
+      if (q == p) {
+        break;
+      }
+      d = q - p;
+      q /= 2;
+      r = p;
+    }
+  }
+}
+
+// 要素数Nのソーティングネットワーク (コンパイル時に生成する)
+template<std::size_t N>
+inline constexpr auto sorting_network = [] {
+  constexpr auto size = [] {
+    auto count = std::size_t{0};
+    for_each_merge_exchange(N, [&](std::size_t, std::size_t) { ++count; });
+    return count;
+  }();
+
+  auto network = std::array<std::pair<std::uint8_t, std::uint8_t>, size>{};
+  auto idx = std::size_t{0};
+  for_each_merge_exchange(N, [&](std::size_t i, std::size_t j) { network[idx++] = {static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(j)}; });
+  return network;
+}();
+
+template<typename T, typename Compare>
+void compare_exchange(T& lhs, T& rhs, Compare& compare) {
+  // 分岐ではなく条件付き移動になるように書く
+  auto const a = lhs;
+  auto const b = rhs;
+  auto const swap = compare(b, a);
+  lhs = swap ? b : a;
+  rhs = swap ? a : b;
+}
+
+template<std::size_t N, typename T, typename Compare>
+void sort_network(T* data, Compare& compare) {
+  constexpr auto const& network = sorting_network<N>;
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    (compare_exchange(data[network[I].first], data[network[I].second], compare), ...);
+  }(std::make_index_sequence<network.size()>{});
+}
+
+/**
+ * @brief 番兵付き挿入ソート
+ *
+ * 最小要素を先頭に移して番兵とし、内側のループから範囲チェックを省く。
+ */
+template<typename T, typename Compare>
+void insertion_sort_sentinel(T* first, T* last, Compare& compare) {
+  if (last - first < 2) {
+    return;
+  }
+  std::iter_swap(first, std::min_element(first, last, compare));
+
+  for (auto it = first + 2; it != last; ++it) {
+    auto const value = *it;
+    auto hole = it;
+    while (compare(value, *(hole - 1))) {
+      *hole = *(hole - 1);
+      --hole;
+    }
+    *hole = value;
+  }
+}
+
+/**
+ * @brief small_sort_max以下の要素数をサイズに応じたアルゴリズムでソートする
+ *
+ * sorting_network_max以下はソーティングネットワーク、それより大きければ番兵付き挿入ソート。
+ */
+template<typename T, typename Compare>
+void small_sort(T* data, std::size_t size, Compare compare) {
+  assert(size <= small_sort_max);
+  if (size <= sorting_network_max) {
+    static constexpr auto table = []<std::size_t... N>(std::index_sequence<N...>) {
+      return std::array{&sort_network<N, T, Compare>...};
+    }(std::make_index_sequence<sorting_network_max + 1>{});
+    table[size](data, compare);
+  } else {
+    insertion_sort_sentinel(data, data + size, compare);
+  }
+}
+
+/*===============================================================================*\
+ * 実装の一覧
+\*===============================================================================*/
+
+enum class strategy {
+  std_map,           // std::multimap
+  flat_map,          // std::flat_multimap
+  btree_map,         // absl::btree_multimap
+  index_pdq,         // インデックス列をpdqsort
+  index_drop_merge,  // インデックス列をdrop-merge sort (ほぼ昇順の入力向け)
+  index_verge,       // インデックス列をvergesort (降順の連続を含む入力向け)
+  small,             // スタック上のインデックス列をソーティングネットワーク/挿入ソート
+  key_sort,          // キー型に特化したソート
+};
+
+inline constexpr auto all_strategies = std::array{
+  strategy::std_map,     strategy::flat_map, strategy::btree_map, strategy::index_pdq, strategy::index_drop_merge,
+  strategy::index_verge, strategy::small,    strategy::key_sort,
+};
+
+inline constexpr auto all_input_shapes = std::array{input_shape::random, input_shape::nearly_sorted, input_shape::descending};
+
+namespace detail {
+
+  template<typename Enum, std::size_t N>
+  constexpr std::string_view name_of(Enum value, std::array<std::pair<Enum, std::string_view>, N> const& names) noexcept {
+    for (auto const& [candidate, name] : names) {
+      if (candidate == value) {
+        return name;
+      }
+    }
+    return "UNKNOWN";
+  }
+
+  template<typename Enum, std::size_t N>
+  constexpr std::optional<Enum> parse_name(std::string_view text, std::array<std::pair<Enum, std::string_view>, N> const& names) noexcept {
+    for (auto const& [value, name] : names) {
+      if (name == text) {
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  inline constexpr auto key_category_names = std::array<std::pair<key_category, std::string_view>, 6>{{
+    {key_category::int32, "INT"},
+    {key_category::int64, "INT64"},
+    {key_category::floating, "DOUBLE"},
+    {key_category::string, "STRING"},
+    {key_category::composite, "TUPLE"},
+    {key_category::other, "OTHER"},
+  }};
+
+  inline constexpr auto input_shape_names = std::array<std::pair<input_shape, std::string_view>, 3>{{
+    {input_shape::random, "RANDOM"},
+    {input_shape::nearly_sorted, "NEARLY_SORTED"},
+    {input_shape::descending, "DESCENDING"},
+  }};
+
+  inline constexpr auto strategy_names = std::array<std::pair<strategy, std::string_view>, 8>{{
+    {strategy::std_map, "STD_MAP"},
+    {strategy::flat_map, "FLAT_MAP"},
+    {strategy::btree_map, "BTREE_MAP"},
+    {strategy::index_pdq, "INDEX_PDQ"},
+    {strategy::index_drop_merge, "INDEX_DROP_MERGE"},
+    {strategy::index_verge, "INDEX_VERGE"},
+    {strategy::small, "SMALL"},
+    {strategy::key_sort, "KEY_SORT"},
+  }};
+
+} // namespace detail
+
+constexpr std::string_view to_string(key_category category) noexcept { return detail::name_of(category, detail::key_category_names); }
+constexpr std::string_view to_string(input_shape shape) noexcept { return detail::name_of(shape, detail::input_shape_names); }
+constexpr std::string_view to_string(strategy chosen) noexcept { return detail::name_of(chosen, detail::strategy_names); }
+
+/*===============================================================================*\
+ * キャリブレーション
+\*===============================================================================*/
+
+/**
+ * @brief キー型・並び方・要素数ごとに使う実装の表
+ *
+ * ベンチマークの --calibrate で計測した結果をファイルに保存し、load()で読み込む。
+ * ファイルは1行に「キー型 並び方 最大要素数 実装」を空白区切りで書く。#以降はコメント。
+ * 表にない組み合わせは組み込みの既定値(default_strategy)を使う。
+ */
+class calibration {
+public:
+  struct entry {
+    key_category key;
+    input_shape shape;
+    std::size_t max_count;
+    strategy chosen;
+  };
+
+  // 既定の選択基準 (キャリブレーション結果がない場合に使う)
+  static constexpr strategy default_strategy(key_category /*key*/, input_shape shape, std::size_t count) noexcept {
+    if (count <= small_sort_max) {
+      return strategy::small;
+    }
+    switch (shape) {
+    case input_shape::nearly_sorted:
+      return strategy::index_drop_merge;
+    case input_shape::descending:
+      return strategy::index_verge;
+    case input_shape::random:
+      break;
+    }
+    return strategy::key_sort;
+  }
+
+  // count件以下の入力にはchosenを使う
+  void set(key_category key, input_shape shape, std::size_t max_count, strategy chosen) {
+    auto const it = std::ranges::find_if(entries_, [&](entry const& e) { return e.key == key and e.shape == shape and e.max_count == max_count; });
+    if (it != entries_.end()) {
+      it->chosen = chosen;
+      return;
+    }
+    entries_.push_back({key, shape, max_count, chosen});
+    std::ranges::sort(entries_, std::ranges::less{}, [](entry const& e) { return std::tuple{e.key, e.shape, e.max_count}; });
+  }
+
+  strategy select(key_category key, input_shape shape, std::size_t count) const noexcept {
+    auto const* last_match = static_cast<entry const*>(nullptr);
+    for (auto const& e : entries_) {
+      if (e.key != key or e.shape != shape) {
+        continue;
+      }
+      if (count <= e.max_count) {
+        return e.chosen;
+      }
+      last_match = &e;
+    }
+    return last_match ? last_match->chosen : default_strategy(key, shape, count);
+  }
+
+  std::span<entry const> entries() const noexcept { return entries_; }
+
+  bool save(std::filesystem::path const& path) const {
+    auto file = std::ofstream{path};
+    if (not file) {
+      return false;
+    }
+    file << "# key shape max_count strategy\n";
+    for (auto const& e : entries_) {
+      file << to_string(e.key) << ' ' << to_string(e.shape) << ' ' << e.max_count << ' ' << to_string(e.chosen) << '\n';
+    }
+    return static_cast<bool>(file);
+  }
+
+  // ファイルが開けない場合はnullopt。解釈できない行は読み飛ばす。
+  static std::optional<calibration> load(std::filesystem::path const& path) {
+    auto file = std::ifstream{path};
+    if (not file) {
+      return std::nullopt;
+    }
+
+    auto result = calibration{};
+    auto line = std::string{};
+    while (std::getline(file, line)) {
+      line.erase(std::ranges::find(line, '#'), line.end());
+
+      auto fields = std::istringstream{line};
+      auto key_text = std::string{};
+      auto shape_text = std::string{};
+      auto max_count = std::size_t{};
+      auto strategy_text = std::string{};
+      if (not(fields >> key_text >> shape_text >> max_count >> strategy_text)) {
+        continue;
+      }
+
+      auto const key = detail::parse_name(key_text, detail::key_category_names);
+      auto const shape = detail::parse_name(shape_text, detail::input_shape_names);
+      auto const chosen = detail::parse_name(strategy_text, detail::strategy_names);
+      if (key and shape and chosen) {
+        result.set(*key, *shape, max_count, *chosen);
+      }
+    }
+    return result;
+  }
+
+private:
+  std::vector<entry> entries_;
+};
+
+/*===============================================================================*\
+ * 各実装
+\*===============================================================================*/
+
+namespace detail {
+
+  template<typename Multimap, typename Key, typename Value, typename Visitor>
+  void visit_by_multimap(std::span<Key const> keys, std::span<Value const> values, Visitor& visitor) {
+    auto map = Multimap{};
+
+    // std::flat_multimapについては事前に容量を確保しておく
+    if constexpr (requires { std::move(map).extract(); }) {
+      auto [map_keys, map_values] = std::move(map).extract();
+      map_keys.reserve(keys.size());
+      map_values.reserve(keys.size());
+      map.replace(std::move(map_keys), std::move(map_values));
+    }
+
+    for (auto idx = std::size_t{0}; idx < keys.size(); ++idx) {
+      map.emplace(keys[idx], idx);
+    }
+
+    for (auto const& [key, index] : map) {
+      visitor(key, values[index]);
+    }
+  }
+
+  template<typename Sorter, typename Key, typename Value, typename Visitor>
+  void visit_by_index_sort(std::span<Key const> keys, std::span<Value const> values, Visitor& visitor) {
+    std::vector<std::size_t> indices(keys.size());
+    std::ranges::iota(indices, std::size_t{});
+
+    auto const sorter = Sorter{};
+    sorter(indices, [&, compare = key_less<Key>{}](std::size_t const lhs, std::size_t const rhs) {
+      return compare(keys[lhs], keys[rhs]);
+    });
+
+    for (auto const index : indices) {
+      visitor(keys[index], values[index]);
+    }
+  }
+
+  // インデックスはスタック上のuint8_t配列に置き、ヒープ確保を避ける
+  template<typename Key, typename Value, typename Visitor>
+  void visit_by_small_sort(std::span<Key const> keys, std::span<Value const> values, Visitor& visitor) {
+    if (keys.size() > small_sort_max) {
+      visit_by_index_sort<cppsort::pdq_sorter>(keys, values, visitor);
+      return;
+    }
+
+    auto indices = std::array<std::uint8_t, small_sort_max>{};
+    std::iota(indices.begin(), indices.begin() + keys.size(), std::uint8_t{});
+
+    small_sort(indices.data(), keys.size(), [&, compare = key_less<Key>{}](std::uint8_t const lhs, std::uint8_t const rhs) {
+      return compare(keys[lhs], keys[rhs]);
+    });
+
+    for (auto const index : std::span{indices.data(), keys.size()}) {
+      visitor(keys[index], values[index]);
+    }
+  }
+
+  /**
+   * @brief キー型ごとに特化したソート
+   *
+   * インデックス経由の間接比較をやめ、キー(またはその順序を保つ代替値)と
+   * インデックスを隣接させて並べることでキャッシュミスを減らす。
+   */
+  template<typename Key, typename Value, typename Visitor>
+  void visit_by_key_sort(std::span<Key const> keys, std::span<Value const> values, Visitor& visitor) {
+    auto const COUNT = keys.size();
+    // インデックスを32bitに詰めるので、収まらない要素数はインデックスソートに任せる
+    if (COUNT > std::numeric_limits<std::uint32_t>::max()) {
+      visit_by_index_sort<cppsort::pdq_sorter>(keys, values, visitor);
+      return;
+    }
+
+    constexpr auto category = key_category_v<Key>;
+    if constexpr (category == key_category::int32) {
+      // 上位32bitに符号を反転したキー、下位32bitにインデックスを詰めて整数として並べる
+      std::vector<std::uint64_t> packed(COUNT);
+      for (auto idx = std::size_t{0}; idx < COUNT; ++idx) {
+        auto const biased = static_cast<std::uint32_t>(static_cast<std::int32_t>(keys[idx])) ^ std::uint32_t{0x8000'0000};
+        packed[idx] = (std::uint64_t{biased} << 32) | idx;
+      }
+      std::ranges::sort(packed);
+
+      for (auto const entry : packed) {
+        auto const index = static_cast<std::size_t>(entry & 0xFFFF'FFFF);
+        visitor(keys[index], values[index]);
+      }
+    } else if constexpr (category == key_category::int64 || category == key_category::floating) {
+      // 浮動小数点数はtotalOrderを保つ整数に変換するのでNaNや±0も整数比較で扱える
+      using sort_key = std::conditional_t<category == key_category::floating, std::uint64_t, Key>;
+      std::vector<std::pair<sort_key, std::uint32_t>> pairs(COUNT);
+      for (auto idx = std::size_t{0}; idx < COUNT; ++idx) {
+        if constexpr (category == key_category::floating) {
+          pairs[idx] = {total_order_bits(static_cast<double>(keys[idx])), static_cast<std::uint32_t>(idx)};
+        } else {
+          pairs[idx] = {keys[idx], static_cast<std::uint32_t>(idx)};
+        }
+      }
+      std::ranges::sort(pairs, std::ranges::less{}, &std::pair<sort_key, std::uint32_t>::first);
+
+      for (auto const& [_, index] : pairs) {
+        visitor(keys[index], values[index]);
+      }
+    } else if constexpr (category == key_category::string) {
+      // 文字列はstring_viewとインデックスの組を並べ、比較時の間接参照を1段減らす
+      std::vector<std::pair<std::string_view, std::uint32_t>> pairs(COUNT);
+      for (auto idx = std::size_t{0}; idx < COUNT; ++idx) {
+        pairs[idx] = {std::string_view{keys[idx]}, static_cast<std::uint32_t>(idx)};
+      }
+      std::ranges::sort(pairs, std::ranges::less{}, &std::pair<std::string_view, std::uint32_t>::first);
+
+      for (auto const& [_, index] : pairs) {
+        visitor(keys[index], values[index]);
+      }
+    } else if constexpr (category == key_category::composite) {
+      // 複合キーは先頭の整数で先に比較し、一致した場合だけキー全体を比較する
+      using head = std::tuple_element_t<0, Key>;
+      std::vector<std::pair<head, std::uint32_t>> pairs(COUNT);
+      for (auto idx = std::size_t{0}; idx < COUNT; ++idx) {
+        pairs[idx] = {std::get<0>(keys[idx]), static_cast<std::uint32_t>(idx)};
+      }
+      auto sorter = cppsort::pdq_sorter{};
+      sorter(pairs, [&, compare = key_less<Key>{}](auto const& lhs, auto const& rhs) {
+        if (lhs.first != rhs.first) {
+          return lhs.first < rhs.first;
+        }
+        return compare(keys[lhs.second], keys[rhs.second]);
+      });
+
+      for (auto const& [_, index] : pairs) {
+        visitor(keys[index], values[index]);
+      }
+    } else {
+      visit_by_index_sort<cppsort::pdq_sorter>(keys, values, visitor);
+    }
+  }
+
+} // namespace detail
+
+namespace detail {
+
+  // 連続した範囲を要素がconstのspanにする (std::span<int>のような可変のspanもstd::span<int const>になる)
+  template<std::ranges::contiguous_range Range>
+  std::span<std::ranges::range_value_t<Range> const> as_const_span(Range const& range) noexcept {
+    return {std::ranges::data(range), std::ranges::size(range)};
+  }
+
+  static_assert(std::is_same_v<decltype(as_const_span(std::declval<std::span<int> const&>())), std::span<int const>>);
+  static_assert(std::is_same_v<decltype(as_const_span(std::declval<std::vector<int> const&>())), std::span<int const>>);
+
+} // namespace detail
+
+/**
+ * @brief 指定した実装でキーの順に visitor(key, value) を呼び出す
+ *
+ */
+template<typename Key, typename Value, typename Visitor>
+void sort_by_key_with(strategy chosen, std::span<Key const> keys, std::span<Value const> values, Visitor&& visitor) {
+  assert(keys.size() == values.size());
+
+  switch (chosen) {
+  case strategy::std_map:
+    detail::visit_by_multimap<std::multimap<Key, std::size_t, key_less<Key>>>(keys, values, visitor);
+    return;
+  case strategy::flat_map:
+    detail::visit_by_multimap<std::flat_multimap<Key, std::size_t, key_less<Key>>>(keys, values, visitor);
+    return;
+  case strategy::btree_map:
+    detail::visit_by_multimap<absl::btree_multimap<Key, std::size_t, key_less<Key>>>(keys, values, visitor);
+    return;
+  case strategy::index_pdq:
+    detail::visit_by_index_sort<cppsort::pdq_sorter>(keys, values, visitor);
+    return;
+  case strategy::index_drop_merge:
+    detail::visit_by_index_sort<cppsort::drop_merge_sorter>(keys, values, visitor);
+    return;
+  case strategy::index_verge:
+    detail::visit_by_index_sort<cppsort::verge_sorter>(keys, values, visitor);
+    return;
+  case strategy::small:
+    detail::visit_by_small_sort(keys, values, visitor);
+    return;
+  case strategy::key_sort:
+    detail::visit_by_key_sort(keys, values, visitor);
+    return;
+  }
+}
+
+template<std::ranges::contiguous_range Keys, std::ranges::contiguous_range Values, typename Visitor>
+void sort_by_key_with(strategy chosen, Keys const& keys, Values const& values, Visitor&& visitor) {
+  // テンプレート引数を明示して、必ずspan版を呼ぶ
+  sort_by_key_with<std::ranges::range_value_t<Keys>, std::ranges::range_value_t<Values>>(chosen, detail::as_const_span(keys), detail::as_const_span(values), visitor);
+}
+
+/**
+ * @brief 最速と見込まれる実装を選んでキーの順に visitor(key, value) を呼び出す
+ *
+ * キー型(コンパイル時)と要素数・入力の並び方(実行時)をtableに照らして実装を選ぶ。
+ */
+template<typename Key, typename Value, typename Visitor>
+void sort_by_key(std::span<Key const> keys, std::span<Value const> values, Visitor&& visitor, calibration const& table = calibration{}) {
+  auto const chosen = table.select(key_category_v<Key>, detect_shape(keys), keys.size());
+  sort_by_key_with(chosen, keys, values, visitor);
+}
+
+template<std::ranges::contiguous_range Keys, std::ranges::contiguous_range Values, typename Visitor>
+void sort_by_key(Keys const& keys, Values const& values, Visitor&& visitor, calibration const& table = calibration{}) {
+  // テンプレート引数を明示して、必ずspan版を呼ぶ
+  sort_by_key<std::ranges::range_value_t<Keys>, std::ranges::range_value_t<Values>>(detail::as_const_span(keys), detail::as_const_span(values), visitor, table);
+}
+
+} // namespace sort_by_map
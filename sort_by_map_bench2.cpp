@@ -1,18 +1,45 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <flat_map>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <random>
 #include <ranges>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "absl/container/btree_map.h"
 #include "faker-cxx/faker.h"
+#include "cpp-sort/probes.h"
+#include "cpp-sort/sorters/drop_merge_sorter.h"
+#include "cpp-sort/sorters/merge_sorter.h"
 #include "cpp-sort/sorters/pdq_sorter.h"
+#include "cpp-sort/sorters/ska_sorter.h"
+#include "cpp-sort/sorters/split_sorter.h"
+#include "cpp-sort/sorters/spread_sorter.h"
+#include "cpp-sort/sorters/std_sorter.h"
+#include "cpp-sort/sorters/tim_sorter.h"
+#include "cpp-sort/sorters/verge_sorter.h"
 
 #include "celero/Celero.h"
+#include "celero/UserDefinedMeasurementTemplate.h"
+
+#include "sort_by_key.h"
+#include "streaming_sort_by_key.h"
 
 namespace {
 
@@ -28,6 +55,137 @@ template<class T>
 inline constexpr bool is_std_flat_map_v =
   is_std_flat_map<std::remove_cvref_t<T>>::value;
 
+template<typename>
+inline constexpr bool always_false_v = false;
+
+/*===============================================================================*\
+ * キー型・値型の定義
+\*===============================================================================*/
+
+template<typename... Types>
+struct type_list {};
+
+// 複合キー (整数が同じ場合は文字列で比較する)
+using tuple_key = std::tuple<int, std::string>;
+
+// ベンチマーク対象のキー型・値型の一覧
+using all_key_types   = type_list<int, std::int64_t, double, std::string, tuple_key>;
+using all_value_types = type_list<int, double, std::string>;
+
+using sort_by_map::key_less;
+
+template<typename T>
+inline constexpr char const* type_name_v = nullptr;
+template<>
+inline constexpr char const* type_name_v<int> = "INT";
+template<>
+inline constexpr char const* type_name_v<std::int64_t> = "INT64";
+template<>
+inline constexpr char const* type_name_v<double> = "DOUBLE";
+template<>
+inline constexpr char const* type_name_v<std::string> = "STRING";
+template<>
+inline constexpr char const* type_name_v<tuple_key> = "TUPLE";
+
+// mapに格納する値の型 (文字列はコピーせずポインタで持つ)
+template<typename Value>
+using stored_value_t = std::conditional_t<std::is_arithmetic_v<Value>, Value, Value const*>;
+
+// 値を最適化で消されないように参照する
+template<typename T>
+void observe(T const& value) {
+  if constexpr (std::is_pointer_v<T>) {
+    observe(*value);
+  } else if constexpr (std::is_arithmetic_v<T>) {
+    celero::DoNotOptimizeAway(value);
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    celero::DoNotOptimizeAway(value.size());
+  } else if constexpr (std::is_same_v<T, tuple_key>) {
+    observe(std::get<0>(value));
+    observe(std::get<1>(value));
+  } else {
+    static_assert(always_false_v<T>, "unsupported type");
+  }
+}
+
+// 生成するキー列の並び方 (random: 一様乱数, nearly_sorted: 昇順から約1%を入れ替え, descending: 降順)
+using DataShape = sort_by_map::input_shape;
+
+constexpr char const* shape_name(DataShape shape) noexcept {
+  // to_stringは文字列リテラルを指すstring_viewを返すのでdata()は終端まで有効
+  return sort_by_map::to_string(shape).data();
+}
+
+/**
+ * @brief キー列をshapeに従って並べ替える
+ *
+ */
+template<typename T>
+void apply_shape(std::vector<T>& keys, DataShape shape, std::mt19937& engine) {
+  switch (shape) {
+  case DataShape::random:
+    return;
+  case DataShape::nearly_sorted: {
+    std::ranges::sort(keys, key_less<T>{});
+    if (keys.size() < 2) {
+      return;
+    }
+    auto pick = std::uniform_int_distribution<std::size_t>{0, keys.size() - 1};
+    for (auto swaps = std::max<std::size_t>(keys.size() / 100, 1); swaps > 0; --swaps) {
+      std::swap(keys[pick(engine)], keys[pick(engine)]);
+    }
+    return;
+  }
+  case DataShape::descending:
+    std::ranges::sort(keys, key_less<T>{});
+    std::ranges::reverse(keys);
+    return;
+  }
+}
+
+/**
+ * @brief cpp-sortのprobeで計測したキー列の事前整列度
+ *
+ * ソーター選択の参考にするため、ベンチマーク開始前に全データセットをまとめて計測する。
+ */
+struct Presortedness {
+  std::ptrdiff_t runs = 0;
+  std::ptrdiff_t inv  = 0;
+  std::ptrdiff_t rem  = 0;
+  std::ptrdiff_t exc  = 0;
+  std::ptrdiff_t ham  = 0;
+  std::ptrdiff_t max  = 0;
+  std::ptrdiff_t enc  = 0;
+  std::ptrdiff_t mono = 0;
+
+  template<typename Key>
+  static Presortedness measure(std::vector<Key> const& keys) {
+    auto const compare = key_less<Key>{};
+
+    auto result = Presortedness{};
+    result.runs = cppsort::probe::runs(keys, compare);
+    result.inv  = cppsort::probe::inv(keys, compare);
+    result.rem  = cppsort::probe::rem(keys, compare);
+    result.exc  = cppsort::probe::exc(keys, compare);
+    result.ham  = cppsort::probe::ham(keys, compare);
+    result.max  = cppsort::probe::max(keys, compare);
+    result.enc  = cppsort::probe::enc(keys, compare);
+    result.mono = cppsort::probe::mono(keys, compare);
+    return result;
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, Presortedness const& measures) {
+  return os << "runs=" << measures.runs << " inv=" << measures.inv << " rem=" << measures.rem << " exc=" << measures.exc << " ham=" << measures.ham << " max=" << measures.max
+            << " enc=" << measures.enc << " mono=" << measures.mono;
+}
+
+// CSVの1行分 (列の順はreport_presortednessの見出し行と同じ)
+void write_csv(std::ostream& os, Presortedness const& measures) {
+  os << measures.runs << ',' << measures.inv << ',' << measures.rem << ',' << measures.exc << ',' << measures.ham << ',' << measures.max << ',' << measures.enc << ','
+     << measures.mono;
+}
+
 
 /*===============================================================================*\
  * 以下Celeroを使ったベンチマーク定義
@@ -40,12 +198,36 @@ inline constexpr bool is_std_flat_map_v =
 struct SharedTestData {
   std::vector<int> int_keys;
   std::vector<int> int_values;
+  std::vector<std::int64_t> int64_keys;
+  std::vector<double> double_keys;
+  std::vector<double> double_values;
   std::vector<std::string> string_keys;
   std::vector<std::string> string_values;
+  std::vector<tuple_key> tuple_keys;
 
   bool initialized = false;
 
-  void initialize(int count) {
+  // キー型に対応するキー列
+  template<typename Key>
+  auto const& keys() const {
+    return key_column<Key>(*this);
+  }
+
+  // 値型に対応する値列
+  template<typename Value>
+  auto const& values() const {
+    if constexpr (std::is_same_v<Value, int>) {
+      return int_values;
+    } else if constexpr (std::is_same_v<Value, double>) {
+      return double_values;
+    } else if constexpr (std::is_same_v<Value, std::string>) {
+      return string_values;
+    } else {
+      static_assert(always_false_v<Value>, "unsupported value type");
+    }
+  }
+
+  void initialize(int count, DataShape shape = DataShape::random) {
     if (initialized) {
       return;
     }
@@ -55,22 +237,128 @@ struct SharedTestData {
       return std::uniform_int_distribution<>{0, 65536}(engine);
     };
 
+    auto engine = std::mt19937_64{std::random_device{}()};
+    auto rand64 = std::uniform_int_distribution<std::int64_t>{};
+    auto rand_real = std::uniform_real_distribution<double>{-65536.0, 65536.0};
+
     int_keys.resize(count);
     int_values.resize(count);
+    int64_keys.resize(count);
+    double_keys.resize(count);
+    double_values.resize(count);
     string_keys.resize(count);
     string_values.resize(count);
+    tuple_keys.resize(count);
 
     for (auto const idx : std::ranges::views::iota(0, count)) {
       int_keys[idx] = rand();
       int_values[idx] = rand();
+      int64_keys[idx] = rand64(engine);
+      double_values[idx] = rand_real(engine);
       string_keys[idx] = std::string{faker::color::name(faker::Locale::ja_JP)} + "#" + std::to_string(idx);
       string_values[idx] = faker::company::catchPhrase(faker::Locale::ja_JP);
+      // 整数部分を重複させて文字列での比較も発生させる
+      tuple_keys[idx] = tuple_key{rand() % 1024, faker::color::name(faker::Locale::ja_JP)};
+
+      // NaNと±0を一定間隔で混ぜる
+      switch (idx % 97) {
+      case 0:
+        double_keys[idx] = std::numeric_limits<double>::quiet_NaN();
+        break;
+      case 1:
+        double_keys[idx] = -std::numeric_limits<double>::quiet_NaN();
+        break;
+      case 2:
+        double_keys[idx] = -0.0;
+        break;
+      case 3:
+        double_keys[idx] = 0.0;
+        break;
+      default:
+        double_keys[idx] = rand_real(engine);
+        break;
+      }
     }
 
+    auto shape_engine = std::mt19937{std::random_device{}()};
+    [&]<typename... Keys>(type_list<Keys...>) {
+      (apply_shape(key_column<Keys>(*this), shape, shape_engine), ...);
+    }(all_key_types{});
+
     initialized = true;
   }
+
+private:
+  template<typename Key, typename Self>
+  static std::conditional_t<std::is_const_v<Self>, std::vector<Key> const&, std::vector<Key>&> key_column(Self& self) {
+    if constexpr (std::is_same_v<Key, int>) {
+      return self.int_keys;
+    } else if constexpr (std::is_same_v<Key, std::int64_t>) {
+      return self.int64_keys;
+    } else if constexpr (std::is_same_v<Key, double>) {
+      return self.double_keys;
+    } else if constexpr (std::is_same_v<Key, std::string>) {
+      return self.string_keys;
+    } else if constexpr (std::is_same_v<Key, tuple_key>) {
+      return self.tuple_keys;
+    } else {
+      static_assert(always_false_v<Key>, "unsupported key type");
+    }
+  }
 };
 
+// 計測する要素数と繰り返し回数
+inline constexpr auto experiment_values = std::array<std::pair<int, int>, 4>{{{10, 1000}, {100, 1000}, {1000, 1000}, {10000, 100}}};
+
+// 要素数・並び方ごとに生成済みのテストデータを返す
+SharedTestData* shared_test_data(int count, DataShape shape) {
+  static std::map<std::pair<DataShape, int>, SharedTestData> cache;
+  auto& data = cache[{shape, count}];
+  if (not data.initialized) {
+    data.initialize(count, shape);
+  }
+  return &data;
+}
+
+// 既整列度の計測結果のファイル (環境変数SORT_BY_KEY_PRESORTEDNESSで変更できる)
+char const* presortedness_path() {
+  auto const* path = std::getenv("SORT_BY_KEY_PRESORTEDNESS");
+  return path ? path : "sort_by_key_presortedness.csv";
+}
+
+/**
+ * @brief 全データセット(並び方 x 要素数 x キー型)の既整列度を標準出力とpathのCSVに書き出す
+ *
+ * データセットはここで生成され、以降のベンチマークはshared_test_dataのキャッシュから同じものを使う。
+ * Celeroの結果表の前にまとめて出力し、CSVはCeleroの結果と要素数・並び方で突き合わせられる。
+ */
+bool report_presortedness(char const* path) {
+  auto csv = std::ofstream{path};
+  csv << "shape,count,key,runs,inv,rem,exc,ham,max,enc,mono\n";
+  for (auto const shape : sort_by_map::all_input_shapes) {
+    for (auto const& [count, iterations] : experiment_values) {
+      auto const* bench_data = shared_test_data(count, shape);
+      [&]<typename... Keys>(type_list<Keys...>) {
+        auto const report = [&]<typename Key>() {
+          auto const measures = Presortedness::measure(bench_data->keys<Key>());
+          std::cout << "[presortedness] shape=" << shape_name(shape) << " count=" << count << " key=" << type_name_v<Key> << ' ' << measures << '\n';
+          csv << shape_name(shape) << ',' << count << ',' << type_name_v<Key> << ',';
+          write_csv(csv, measures);
+          csv << '\n';
+        };
+        (report.template operator()<Keys>(), ...);
+      }(all_key_types{});
+    }
+  }
+
+  if (not csv) {
+    std::cerr << "failed to write presortedness: " << path << '\n';
+    return false;
+  }
+  std::cout << "[presortedness] written to " << path << '\n' << std::endl;
+  return true;
+}
+
 /**
  * @brief 共通テストデータを共有するためのCeleroフィクスチャ
  *
@@ -79,421 +367,615 @@ class SharedDataFixture : public celero::TestFixture {
 public:
   std::vector<std::shared_ptr<celero::TestFixture::ExperimentValue>> getExperimentValues() const override {
     auto values = std::vector<std::shared_ptr<celero::TestFixture::ExperimentValue>>{};
-    values.emplace_back(makeExperimentValue(10, 1000));
-    values.emplace_back(makeExperimentValue(100, 1000));
-    values.emplace_back(makeExperimentValue(1000, 1000));
-    values.emplace_back(makeExperimentValue(10000, 100));
+    for (auto const& [count, iterations] : experiment_values) {
+      if (static_cast<std::size_t>(count) <= max_count) {
+        values.emplace_back(makeExperimentValue(count, iterations));
+      }
+    }
     return values;
   }
 
   void setUp(const celero::TestFixture::ExperimentValue* experimentValue) override {
     this->count = static_cast<int>(experimentValue->Value);
-    static std::map<int, SharedTestData> cache;
-    if (not cache[count].initialized) {
-      cache[count].initialize(this->count);
-    }
-    shared_data = &cache[count];
+    shared_data = shared_test_data(this->count, shape);
   }
 
   int count = 0;
   SharedTestData* shared_data = nullptr;
 
+protected:
+  DataShape shape = DataShape::random;
+  std::size_t max_count = std::numeric_limits<std::size_t>::max();  // これより多い要素数は計測しない
+
 private:
   static std::shared_ptr<celero::TestFixture::ExperimentValue> makeExperimentValue(std::int64_t value, std::int64_t iterations) {
     return std::make_shared<celero::TestFixture::ExperimentValue>(value, iterations);
   }
 };
 
-// int -> int map benchmarks
+/**
+ * @brief キー列の並び方を指定したCeleroフィクスチャ
+ *
+ */
+template<DataShape Shape>
+class ShapedDataFixture : public SharedDataFixture {
+public:
+  ShapedDataFixture() { this->shape = Shape; }
+};
 
-void loop_number_number_baseline(SharedTestData const* bench_data) {
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(bench_data->int_keys.size()))) {
-    auto const key = bench_data->int_keys[idx];
-    auto const value = bench_data->int_values[idx];
-    celero::DoNotOptimizeAway(key);
-    celero::DoNotOptimizeAway(value);
+/*===============================================================================*\
+ * コンテナ x キー型 x 値型
+\*===============================================================================*/
+
+template<typename Key, typename Value>
+void loop_key_value_baseline(SharedTestData const* bench_data) {
+  auto const& keys = bench_data->keys<Key>();
+  auto const& values = bench_data->values<Value>();
+
+  for (auto const idx : std::ranges::views::iota(std::size_t{}, keys.size())) {
+    observe(keys[idx]);
+    observe(values[idx]);
   }
 }
 
-template<typename T>
-void loop_number_number(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+// 重複したキーはtry_emplaceで最初の値だけを残す。
+// sort_by_keyのSTD_MAP/FLAT_MAP/BTREE_MAPはmultimapで全件を残すため、AUTO_*の同名の実装とは計測値を比較できない。
+template<typename Map, typename Key, typename Value>
+void loop_key_value_map(SharedTestData const* bench_data) {
+  auto const& keys = bench_data->keys<Key>();
+  auto const& values = bench_data->values<Value>();
+  auto const COUNT = keys.size();
 
-  auto map = T{};
+  auto map = Map{};
 
   // std::flat_mapについては事前に容量を確保しておく
-  if constexpr (is_std_flat_map_v<T>) {
-    auto [keys, values] = std::move(map).extract();
-    if constexpr (requires { keys.reserve(COUNT); }) {
-      keys.reserve(COUNT);
+  if constexpr (is_std_flat_map_v<Map>) {
+    auto [map_keys, map_values] = std::move(map).extract();
+    if constexpr (requires { map_keys.reserve(COUNT); }) {
+      map_keys.reserve(COUNT);
     }
-    if constexpr (requires { values.reserve(COUNT); }) {
-      values.reserve(COUNT);
+    if constexpr (requires { map_values.reserve(COUNT); }) {
+      map_values.reserve(COUNT);
     }
-    map.replace(std::move(keys), std::move(values));
+    map.replace(std::move(map_keys), std::move(map_values));
   }
 
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = bench_data->int_keys[idx];
-    auto const value = bench_data->int_values[idx];
-    map.try_emplace(key, value);
+  for (auto const idx : std::ranges::views::iota(std::size_t{}, COUNT)) {
+    if constexpr (std::is_pointer_v<stored_value_t<Value>>) {
+      map.try_emplace(keys[idx], &values[idx]);
+    } else {
+      map.try_emplace(keys[idx], values[idx]);
+    }
   }
 
   for (const auto& [_, value] : map) {
-    celero::DoNotOptimizeAway(value);
+    observe(value);
   }
 }
 
-template<typename T, typename U>
-void loop_number_number_array(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
-
-  auto const& keys = bench_data->int_keys;
-  auto const& values = bench_data->int_values;
+template<typename Key, typename Value>
+void loop_key_value_array(SharedTestData const* bench_data) {
+  auto const& keys = bench_data->keys<Key>();
+  auto const& values = bench_data->values<Value>();
+  auto const COUNT = keys.size();
 
   std::vector<std::size_t> indices(COUNT);
   std::ranges::iota(indices, std::size_t{});
 
-  std::ranges::sort(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
+  std::ranges::sort(indices, [&, compare = key_less<Key>{}](auto const lhs, auto const rhs) {
+    return compare(keys[lhs], keys[rhs]);
   });
 
   for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index]);
+    observe(values[index]);
   }
 }
 
-template<typename T, typename U>
-void loop_number_number_array_cppsort(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+// sort_by_keyライブラリの実装を固定して計測する
+template<sort_by_map::strategy Strategy, typename Key, typename Value>
+void loop_key_value_strategy(SharedTestData const* bench_data) {
+  sort_by_map::sort_by_key_with(Strategy, bench_data->keys<Key>(), bench_data->values<Value>(), [](auto const&, auto const& value) {
+    observe(value);
+  });
+}
 
-  auto const& keys = bench_data->int_keys;
-  auto const& values = bench_data->int_values;
+// 比較対象の実装 (新しい実装はここに追加すると全キー型・値型で計測される)
+struct baseline_contender {
+  static constexpr char const* name = "Baseline";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_baseline<Key, Value>(bench_data); }
+};
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
+struct std_map_contender {
+  static constexpr char const* name = "01_STD_MAP";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_map<std::map<Key, stored_value_t<Value>, key_less<Key>>, Key, Value>(bench_data); }
+};
 
-  auto sorter = cppsort::pdq_sorter{};
-  sorter(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+struct std_flat_map_contender {
+  static constexpr char const* name = "02_STD_FLAT_MAP";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_map<std::flat_map<Key, stored_value_t<Value>, key_less<Key>>, Key, Value>(bench_data); }
+};
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index]);
-  }
-}
+struct abseil_btree_contender {
+  static constexpr char const* name = "03_ABSEIL_BTREE";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_map<absl::btree_map<Key, stored_value_t<Value>, key_less<Key>>, Key, Value>(bench_data); }
+};
 
-void loop_number_string_baseline(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+struct array_contender {
+  static constexpr char const* name = "04_ARRAY";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_array<Key, Value>(bench_data); }
+};
 
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = bench_data->int_keys[idx];
-    auto const value = &bench_data->string_values[idx];
-    celero::DoNotOptimizeAway(key);
-    celero::DoNotOptimizeAway(value);
-  }
-}
+struct array_cppsort_contender {
+  static constexpr char const* name = "05_ARRAY_CPPSORT";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_strategy<sort_by_map::strategy::index_pdq, Key, Value>(bench_data); }
+};
 
-template<typename T>
-void loop_number_string(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+struct array_fast_contender {
+  static constexpr char const* name = "06_ARRAY_FAST";
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_strategy<sort_by_map::strategy::key_sort, Key, Value>(bench_data); }
+};
 
-  T map;
-  // std::flat_mapについては事前に容量を確保しておく
-  if constexpr (is_std_flat_map_v<T>) {
-    auto [keys, values] = std::move(map).extract();
-    if constexpr (requires { keys.reserve(COUNT); }) {
-      keys.reserve(COUNT);
-    }
-    if constexpr (requires { values.reserve(COUNT); }) {
-      values.reserve(COUNT);
+// small_sort_maxより多い要素数ではINDEX_PDQと同じ処理になるので、それ以下の要素数だけを計測する
+struct array_small_contender {
+  static constexpr char const* name = "07_ARRAY_SMALL";
+  static constexpr std::size_t max_count = sort_by_map::small_sort_max;
+  template<typename Key, typename Value>
+  static void run(SharedTestData const* bench_data) { loop_key_value_strategy<sort_by_map::strategy::small, Key, Value>(bench_data); }
+};
+
+using all_contenders = type_list<baseline_contender, std_map_contender, std_flat_map_contender, abseil_btree_contender, array_contender, array_cppsort_contender, array_fast_contender,
+                                 array_small_contender>;
+
+template<typename Contender, typename Key, typename Value>
+class ContenderFixture : public SharedDataFixture {
+public:
+  ContenderFixture() {
+    if constexpr (requires { Contender::max_count; }) {
+      this->max_count = Contender::max_count;
     }
-    map.replace(std::move(keys), std::move(values));
-  }
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = bench_data->int_keys[idx];
-    auto const value = &bench_data->string_values[idx];
-    map.try_emplace(key, value);
   }
 
-  for (const auto& [_, value] : map) {
-    celero::DoNotOptimizeAway(value->size());
-  }
+protected:
+  void UserBenchmark() override { Contender::template run<Key, Value>(this->shared_data); }
+};
+
+/**
+ * @brief 1つのキー型・値型について、全実装を登録する
+ *
+ * 先頭の実装をベースラインとする。
+ */
+template<typename Key, typename Value, typename Baseline, typename... Contenders>
+void register_contender_group(type_list<Baseline, Contenders...>) {
+  auto const group = std::string{type_name_v<Key>} + "_" + type_name_v<Value>;
+  celero::RegisterBaseline(group.c_str(), Baseline::name, 30, 1, 1, std::make_shared<celero::GenericFactory<ContenderFixture<Baseline, Key, Value>>>());
+  (celero::RegisterTest(group.c_str(), Contenders::name, 30, 1, 1, std::make_shared<celero::GenericFactory<ContenderFixture<Contenders, Key, Value>>>()), ...);
 }
 
-template<typename T, typename U>
-void loop_number_string_array(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+template<typename Key, typename... Values, typename Contenders>
+void register_contender_groups(type_list<Values...>, Contenders contenders) {
+  (register_contender_group<Key, Values>(contenders), ...);
+}
 
-  auto const& keys = bench_data->int_keys;
-  auto const& values = bench_data->string_values;
+template<typename... Keys, typename Values, typename Contenders>
+bool register_contender_matrix(type_list<Keys...>, Values values, Contenders contenders) {
+  (register_contender_groups<Keys>(values, contenders), ...);
+  return true;
+}
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
-  std::ranges::sort(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+/*===============================================================================*\
+ * cpp-sortのソーター総当たり
+\*===============================================================================*/
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index].size());
-  }
-}
+/**
+ * @brief インデックスをキーに変換するプロジェクション
+ *
+ * 比較ベースのソーターだけでなく、ska_sorterやspread_sorterのような
+ * キーそのものを必要とするソーターにも同じ形で渡せる。
+ */
+template<typename Key>
+struct index_to_key {
+  std::vector<Key> const* keys;
+
+  Key const& operator()(std::size_t index) const noexcept { return (*keys)[index]; }
+};
 
-template<typename T, typename U>
-void loop_number_string_array_cppsort(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+// キー型が既定の比較(std::less<>)で並べられるかどうか
+template<typename Key>
+inline constexpr bool has_default_order_v = std::is_same_v<key_less<Key>, std::less<>>;
 
-  auto const& keys = bench_data->int_keys;
-  auto const& values = bench_data->string_values;
+// SorterがKey型のキー列を扱えるかどうか
+template<typename Sorter, typename Key>
+inline constexpr bool is_applicable_sorter_v = has_default_order_v<Key> ? std::is_invocable_v<Sorter const&, std::vector<std::size_t>&, index_to_key<Key>>
+                                                                        : std::is_invocable_v<Sorter const&, std::vector<std::size_t>&, key_less<Key>, index_to_key<Key>>;
+
+template<typename Sorter, typename Key>
+void loop_key_number_array_sorter(SharedTestData const* bench_data) {
+  auto const& keys = bench_data->keys<Key>();
+  auto const& values = bench_data->int_values;
+  auto const COUNT = keys.size();
 
   std::vector<std::size_t> indices(COUNT);
   std::ranges::iota(indices, std::size_t{});
 
-  auto sorter = cppsort::pdq_sorter{};
-  sorter(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+  auto const sorter = Sorter{};
+  if constexpr (has_default_order_v<Key>) {
+    sorter(indices, index_to_key<Key>{&keys});
+  } else {
+    sorter(indices, key_less<Key>{}, index_to_key<Key>{&keys});
+  }
 
   for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index].size());
+    celero::DoNotOptimizeAway(values[index]);
   }
 }
 
-void loop_string_number_baseline(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+template<DataShape... Shapes>
+struct shape_list {};
+
+template<typename Sorter>
+inline constexpr char const* sorter_name_v = nullptr;
+template<>
+inline constexpr char const* sorter_name_v<cppsort::std_sorter> = "STD_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::pdq_sorter> = "PDQ_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::ska_sorter> = "SKA_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::spread_sorter> = "SPREAD_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::merge_sorter> = "MERGE_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::drop_merge_sorter> = "DROP_MERGE_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::split_sorter> = "SPLIT_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::tim_sorter> = "TIM_SORTER";
+template<>
+inline constexpr char const* sorter_name_v<cppsort::verge_sorter> = "VERGE_SORTER";
+
+template<typename Sorter, typename Key, DataShape Shape>
+class SorterMatrixFixture : public ShapedDataFixture<Shape> {
+protected:
+  void UserBenchmark() override { loop_key_number_array_sorter<Sorter, Key>(this->shared_data); }
+};
 
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = &bench_data->string_keys[idx];
-    auto const value = bench_data->int_values[idx];
-    celero::DoNotOptimizeAway(key->size());
-    celero::DoNotOptimizeAway(value);
-  }
-}
+/**
+ * @brief 1つのキー型・並び方について、適用可能な全ソーターを登録する
+ *
+ * 先頭のソーターをベースラインとする。
+ */
+template<typename Key, DataShape Shape, typename Baseline, typename... Sorters>
+void register_sorter_group(type_list<Baseline, Sorters...>) {
+  static_assert(is_applicable_sorter_v<Baseline, Key>, "baseline sorter must accept every key type");
 
-template<typename T>
-void loop_string_number(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+  auto const group = std::string{"SORTER_"} + type_name_v<Key> + "_" + shape_name(Shape);
+  celero::RegisterBaseline(group.c_str(), sorter_name_v<Baseline>, 30, 1, 1, std::make_shared<celero::GenericFactory<SorterMatrixFixture<Baseline, Key, Shape>>>());
 
-  T map;
-  // std::flat_mapについては事前に容量を確保しておく
-  if constexpr (is_std_flat_map_v<T>) {
-    auto [keys, values] = std::move(map).extract();
-    if constexpr (requires { keys.reserve(COUNT); }) {
-      keys.reserve(COUNT);
+  auto const register_sorter = [&]<typename Sorter>() {
+    if constexpr (is_applicable_sorter_v<Sorter, Key>) {
+      celero::RegisterTest(group.c_str(), sorter_name_v<Sorter>, 30, 1, 1, std::make_shared<celero::GenericFactory<SorterMatrixFixture<Sorter, Key, Shape>>>());
     }
-    if constexpr (requires { values.reserve(COUNT); }) {
-      values.reserve(COUNT);
-    }
-    map.replace(std::move(keys), std::move(values));
-  }
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = bench_data->string_keys[idx];
-    auto const value = bench_data->int_values[idx];
-    map.try_emplace(key, value);
-  }
+  };
+  (register_sorter.template operator()<Sorters>(), ...);
+}
 
-  for (const auto& [_, value] : map) {
-    celero::DoNotOptimizeAway(value);
-  }
+template<typename Key, DataShape... Shapes, typename Sorters>
+void register_sorter_groups(shape_list<Shapes...>, Sorters sorters) {
+  (register_sorter_group<Key, Shapes>(sorters), ...);
 }
 
-template<typename T, typename U>
-void loop_string_number_array(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+template<typename... Keys, typename Shapes, typename Sorters>
+bool register_sorter_matrix(type_list<Keys...>, Shapes shapes, Sorters sorters) {
+  (register_sorter_groups<Keys>(shapes, sorters), ...);
+  return true;
+}
 
-  auto const& keys = bench_data->string_keys;
-  auto const& values = bench_data->int_values;
+/*===============================================================================*\
+ * sort_by_keyの自動選択とキャリブレーション
+\*===============================================================================*/
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
-  std::ranges::sort(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+// キャリブレーション結果のファイル (環境変数SORT_BY_KEY_CALIBRATIONで変更できる)
+char const* calibration_path() {
+  auto const* path = std::getenv("SORT_BY_KEY_CALIBRATION");
+  return path ? path : "sort_by_key_calibration.txt";
+}
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index]);
-  }
+// 自動選択で使うキャリブレーション結果 (ファイルがなければ既定の選択基準)
+sort_by_map::calibration const& loaded_calibration() {
+  static auto const table = [] {
+    auto loaded = sort_by_map::calibration::load(calibration_path());
+    std::clog << "[calibration] " << (loaded ? "loaded " : "not found, using defaults: ") << calibration_path() << '\n';
+    return loaded.value_or(sort_by_map::calibration{});
+  }();
+  return table;
 }
 
-template<typename T, typename U>
-void loop_string_number_array_cppsort(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+template<typename Key, typename Value>
+void loop_key_value_auto(SharedTestData const* bench_data) {
+  sort_by_map::sort_by_key(bench_data->keys<Key>(), bench_data->values<Value>(), [](auto const&, auto const& value) {
+    observe(value);
+  }, loaded_calibration());
+}
 
-  auto const& keys = bench_data->string_keys;
-  auto const& values = bench_data->int_values;
+template<sort_by_map::strategy Strategy, typename Key, DataShape Shape>
+class StrategyFixture : public ShapedDataFixture<Shape> {
+public:
+  StrategyFixture() {
+    // SMALLはsmall_sort_maxより多い要素数ではINDEX_PDQと同じ処理なので計測しない
+    if constexpr (Strategy == sort_by_map::strategy::small) {
+      this->max_count = sort_by_map::small_sort_max;
+    }
+  }
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
+protected:
+  void UserBenchmark() override { loop_key_value_strategy<Strategy, Key, int>(this->shared_data); }
+};
 
-  auto sorter = cppsort::pdq_sorter{};
-  sorter(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+template<typename Key, DataShape Shape>
+class AutoStrategyFixture : public ShapedDataFixture<Shape> {
+protected:
+  void UserBenchmark() override { loop_key_value_auto<Key, int>(this->shared_data); }
+};
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index]);
-  }
-}
+/**
+ * @brief 1つのキー型・並び方について、固定した各実装と自動選択を登録する
+ *
+ * INDEX_PDQをベースラインとする。
+ * ここでのSTD_MAP/FLAT_MAP/BTREE_MAPは重複キーを残すmultimapで、
+ * コンテナ x キー型 x 値型 の01_STD_MAPなど(try_emplaceで重複を捨てる)とは別物。
+ */
+template<typename Key, DataShape Shape>
+void register_auto_group() {
+  using sort_by_map::strategy;
+
+  auto const group = std::string{"AUTO_"} + type_name_v<Key> + "_" + shape_name(Shape);
+  celero::RegisterBaseline(group.c_str(), sort_by_map::to_string(strategy::index_pdq).data(), 30, 1, 1,
+                           std::make_shared<celero::GenericFactory<StrategyFixture<strategy::index_pdq, Key, Shape>>>());
+
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    auto const register_strategy = [&]<strategy Strategy>() {
+      if constexpr (Strategy != strategy::index_pdq) {
+        celero::RegisterTest(group.c_str(), sort_by_map::to_string(Strategy).data(), 30, 1, 1, std::make_shared<celero::GenericFactory<StrategyFixture<Strategy, Key, Shape>>>());
+      }
+    };
+    (register_strategy.template operator()<sort_by_map::all_strategies[I]>(), ...);
+  }(std::make_index_sequence<sort_by_map::all_strategies.size()>{});
 
-void loop_string_string_baseline(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+  celero::RegisterTest(group.c_str(), "AUTO", 30, 1, 1, std::make_shared<celero::GenericFactory<AutoStrategyFixture<Key, Shape>>>());
+}
 
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const key = bench_data->string_keys[idx];
-    auto const value = bench_data->string_values[idx];
-    celero::DoNotOptimizeAway(key.size());
-    celero::DoNotOptimizeAway(value.size());
-  }
+template<typename Key, std::size_t... I>
+void register_auto_groups(std::index_sequence<I...>) {
+  (register_auto_group<Key, sort_by_map::all_input_shapes[I]>(), ...);
 }
 
-template<typename T>
-void loop_string_string(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+template<typename... Keys>
+bool register_auto_matrix(type_list<Keys...>) {
+  (register_auto_groups<Keys>(std::make_index_sequence<sort_by_map::all_input_shapes.size()>{}), ...);
+  return true;
+}
 
-  T map;
-  // std::flat_mapについては事前に容量を確保しておく
-  if constexpr (is_std_flat_map_v<T>) {
-    auto [keys, values] = std::move(map).extract();
-    if constexpr (requires { keys.reserve(COUNT); }) {
-      keys.reserve(COUNT);
-    }
-    if constexpr (requires { values.reserve(COUNT); }) {
-      values.reserve(COUNT);
+/**
+ * @brief 1つのキー型について、要素数・並び方ごとに最速の実装を計測してtableに記録する
+ *
+ * 計測した要素数の間は幾何平均で区切り、最大の要素数より大きい入力には最後の結果を使う。
+ * 結果はsort_by_keyと同じくdetect_shapeで判定した並び方で記録する。
+ * (例えばcount=10のNEARLY_SORTEDは1回の入れ替えでRANDOMと判定されることがある)
+ * 判定が生成時の並び方と一致するデータセットの結果を優先する。
+ */
+template<typename Key>
+void calibrate_key(sort_by_map::calibration& table) {
+  constexpr auto repeats = 5;
+
+  struct result {
+    DataShape detected;
+    std::size_t max_count;
+    sort_by_map::strategy best;
+    bool matches_generated;
+  };
+  auto results = std::vector<result>{};
+
+  for (auto const shape : sort_by_map::all_input_shapes) {
+    for (auto idx = std::size_t{0}; idx < experiment_values.size(); ++idx) {
+      auto const [count, iterations] = experiment_values[idx];
+      auto const* bench_data = shared_test_data(count, shape);
+      auto const detected = sort_by_map::detect_shape(std::span{bench_data->keys<Key>()});
+
+      auto best = sort_by_map::strategy::index_pdq;
+      auto best_duration = std::numeric_limits<std::int64_t>::max();
+      for (auto const candidate : sort_by_map::all_strategies) {
+        // SMALLはsmall_sort_maxより多い要素数ではINDEX_PDQと同じ処理なので候補にしない
+        if (candidate == sort_by_map::strategy::small and static_cast<std::size_t>(count) > sort_by_map::small_sort_max) {
+          continue;
+        }
+        // repeats回のうち最も速かった回を採用する
+        for (auto repeat = 0; repeat < repeats; ++repeat) {
+          auto const start = std::chrono::steady_clock::now();
+          for (auto iteration = 0; iteration < iterations; ++iteration) {
+            sort_by_map::sort_by_key_with(candidate, bench_data->keys<Key>(), bench_data->int_values, [](auto const&, auto const value) {
+              celero::DoNotOptimizeAway(value);
+            });
+          }
+          auto const end = std::chrono::steady_clock::now();
+          auto const duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+          if (duration < best_duration) {
+            best = candidate;
+            best_duration = duration;
+          }
+        }
+      }
+
+      auto const max_count = idx + 1 < experiment_values.size()
+                               ? static_cast<std::size_t>(std::sqrt(static_cast<double>(count) * experiment_values[idx + 1].first))
+                               : std::numeric_limits<std::size_t>::max();
+      results.push_back({detected, max_count, best, detected == shape});
+      std::clog << "[calibration] key=" << type_name_v<Key> << " shape=" << shape_name(shape) << " detected=" << shape_name(detected) << " count=" << count
+                << " strategy=" << sort_by_map::to_string(best) << " duration=" << best_duration / iterations << " ns\n";
     }
-    map.replace(std::move(keys), std::move(values));
   }
-  for (auto const idx : std::ranges::views::iota(0, static_cast<int>(COUNT))) {
-    auto const& key = bench_data->string_keys[idx];
-    auto const& value = bench_data->string_values[idx];
-    map.try_emplace(key, &value);
+
+  // 生成時の並び方と一致した結果を後から書き込み、同じ区分では優先させる
+  std::ranges::stable_partition(results, [](result const& r) { return not r.matches_generated; });
+  for (auto const& r : results) {
+    table.set(sort_by_map::key_category_v<Key>, r.detected, r.max_count, r.best);
   }
+}
 
-  for (const auto& [_, value] : map) {
-    celero::DoNotOptimizeAway(value->size());
+// 全キー型についてキャリブレーションを行い、結果をpathに書き出す
+bool run_calibration(char const* path) {
+  auto table = sort_by_map::calibration{};
+  [&]<typename... Keys>(type_list<Keys...>) {
+    (calibrate_key<Keys>(table), ...);
+  }(all_key_types{});
+
+  if (not table.save(path)) {
+    std::cerr << "failed to write calibration: " << path << '\n';
+    return false;
   }
+  std::clog << "[calibration] written to " << path << '\n';
+  return true;
 }
 
-template<typename T, typename U>
-void loop_string_string_array(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+/*===============================================================================*\
+ * 逐次実行とパイプライン実行の比較
+\*===============================================================================*/
 
-  auto const& keys = bench_data->string_keys;
-  auto const& values = bench_data->string_values;
+// 生産スレッドが1度に流す行数。どの要素数でもおよそ8つの塊に分けて、複数の列をマージさせる
+constexpr std::size_t pipeline_chunk_size(std::size_t count) noexcept {
+  return std::max<std::size_t>(count / 8, 1);
+}
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
-  std::ranges::sort(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+// 計測開始から最初の結果が得られるまでの時間 (マイクロ秒)
+class FirstResultUDM : public celero::UserDefinedMeasurementTemplate<double> {
+public:
+  std::string getName() const override { return "first_result_us"; }
+};
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index].size());
+/**
+ * @brief 逐次実行・パイプライン実行で共通のフィクスチャ
+ *
+ * 行の生産は元データからpipeline_chunk_size()行ずつキー列・値列をコピーして模擬する。
+ */
+template<typename Key>
+class PipelineFixture : public SharedDataFixture {
+public:
+  PipelineFixture() : first_result{std::make_shared<FirstResultUDM>()} {}
+
+  std::vector<std::shared_ptr<celero::UserDefinedMeasurement>> getUserDefinedMeasurements() const override { return {first_result}; }
+
+protected:
+  template<typename Emit>
+  void produce_rows(Emit&& emit) const {
+    auto const& keys = shared_data->keys<Key>();
+    auto const& values = shared_data->int_values;
+    auto const chunk_size = pipeline_chunk_size(keys.size());
+    for (auto first = std::size_t{0}; first < keys.size(); first += chunk_size) {
+      auto const last = std::min(keys.size(), first + chunk_size);
+      emit(std::vector<Key>(keys.begin() + first, keys.begin() + last), std::vector<int>(values.begin() + first, values.begin() + last));
+    }
   }
-}
 
-template<typename T, typename U>
-void loop_string_string_array_cppsort(SharedTestData const* bench_data) {
-  auto const COUNT = bench_data->int_keys.size();
+  // 最初の結果を受け取ったときに1回だけ経過時間を記録する visitor
+  auto make_visitor(std::chrono::steady_clock::time_point start) {
+    return [this, start, first = true](auto const&, int const value) mutable {
+      if (first) {
+        auto const elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+        first_result->addValue(elapsed.count());
+        first = false;
+      }
+      celero::DoNotOptimizeAway(value);
+    };
+  }
 
-  auto const& keys = bench_data->string_keys;
-  auto const& values = bench_data->string_values;
+  std::shared_ptr<FirstResultUDM> first_result;
+};
 
-  std::vector<std::size_t> indices(COUNT);
-  std::ranges::iota(indices, std::size_t{});
+// 全行を受け取ってからソートし、走査する
+template<typename Key>
+class BatchFixture : public PipelineFixture<Key> {
+protected:
+  void UserBenchmark() override {
+    auto const start = std::chrono::steady_clock::now();
+
+    auto keys = std::vector<Key>{};
+    auto values = std::vector<int>{};
+    keys.reserve(this->shared_data->template keys<Key>().size());
+    values.reserve(this->shared_data->int_values.size());
+    this->produce_rows([&](std::vector<Key> chunk_keys, std::vector<int> chunk_values) {
+      std::ranges::move(chunk_keys, std::back_inserter(keys));
+      std::ranges::move(chunk_values, std::back_inserter(values));
+    });
+
+    sort_by_map::sort_by_key(keys, values, this->make_visitor(start), loaded_calibration());
+  }
+};
 
-  auto sorter = cppsort::pdq_sorter{};
-  sorter(indices, [&](auto const lhs, auto const rhs) {
-    return keys[lhs] < keys[rhs];
-  });
+// 生産・整列・マージをstreaming_sort_by_keyで重ねて実行する
+template<typename Key>
+class StreamingFixture : public PipelineFixture<Key> {
+protected:
+  void UserBenchmark() override {
+    auto const start = std::chrono::steady_clock::now();
 
-  for (auto const index : indices) {
-    celero::DoNotOptimizeAway(values[index].size());
+    sort_by_map::streaming_sort_by_key<Key, int>([&](auto&& emit) { this->produce_rows(emit); }, this->make_visitor(start), loaded_calibration());
   }
+};
+
+template<typename... Keys>
+bool register_pipeline_matrix(type_list<Keys...>) {
+  auto const register_group = [&]<typename Key>() {
+    auto const group = std::string{"PIPELINE_"} + type_name_v<Key>;
+    celero::RegisterBaseline(group.c_str(), "BATCH", 30, 1, 1, std::make_shared<celero::GenericFactory<BatchFixture<Key>>>());
+    celero::RegisterTest(group.c_str(), "STREAMING", 30, 1, 1, std::make_shared<celero::GenericFactory<StreamingFixture<Key>>>());
+  };
+  (register_group.template operator()<Keys>(), ...);
+  return true;
 }
 
 } // namespace
 
-CELERO_MAIN
+// --calibrate [path] でsort_by_keyの選択基準を計測してファイルに書き出す。
+// それ以外の引数はCeleroに渡す。
+int main(int argc, char** argv) {
+  if (argc >= 2 and std::string_view{argv[1]} == "--calibrate") {
+    return run_calibration(argc >= 3 ? argv[2] : calibration_path()) ? 0 : 1;
+  }
+
+  report_presortedness(presortedness_path());
+  celero::Run(argc, argv);
+  return 0;
+}
 
 // samples/iterationsを0にしてCeleroに自動調整させる。
 // countはfixtureのExperimentValueで変化させる。
 
-// int -> int
-BASELINE_F(INT_INT, Baseline, SharedDataFixture, 30, 1) {
-  loop_number_number_baseline(this->shared_data);
-}
-BENCHMARK_F(INT_INT, 01_STD_MAP, SharedDataFixture, 30, 1) {
-  loop_number_number<std::map<int, int>>(this->shared_data);
-}
-BENCHMARK_F(INT_INT, 02_STD_FLAT_MAP, SharedDataFixture, 30, 1) {
-  loop_number_number<std::flat_map<int, int>>(this->shared_data);
-}
-BENCHMARK_F(INT_INT, 03_ABSEIL_BTREE, SharedDataFixture, 30, 1) {
-  loop_number_number<absl::btree_map<int, int>>(this->shared_data);
-}
-BENCHMARK_F(INT_INT, 04_ARRAY, SharedDataFixture, 30, 1) {
-  loop_number_number_array<int, int>(this->shared_data);
-}
-BENCHMARK_F(INT_INT, 05_ARRAY_CPPSORT, SharedDataFixture, 30, 1) {
-  loop_number_number_array_cppsort<int, int>(this->shared_data);
-}
+// コンテナ x キー型 x 値型 (INT_INT, INT_STRING, ...)
+namespace {
+[[maybe_unused]] bool const contender_matrix_registered = register_contender_matrix(all_key_types{}, all_value_types{}, all_contenders{});
+} // namespace
 
-// int -> string
-BASELINE_F(INT_STRING, Baseline, SharedDataFixture, 30, 1) {
-  loop_number_string_baseline(this->shared_data);
-}
-BENCHMARK_F(INT_STRING, 01_STD_MAP, SharedDataFixture, 30, 1) {
-  loop_number_string<std::map<int, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(INT_STRING, 02_STD_FLAT_MAP, SharedDataFixture, 30, 1) {
-  loop_number_string<std::flat_map<int, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(INT_STRING, 03_ABSEIL_BTREE, SharedDataFixture, 30, 1) {
-  loop_number_string<absl::btree_map<int, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(INT_STRING, 04_ARRAY, SharedDataFixture, 30, 1) {
-  loop_number_string_array<int, std::string const*>(this->shared_data);
-}
-BENCHMARK_F(INT_STRING, 05_ARRAY_CPPSORT, SharedDataFixture, 30, 1) {
-  loop_number_string_array_cppsort<int, std::string const*>(this->shared_data);
-}
+// cpp-sortのソーター総当たり (キー型 x 並び方 x ソーター)
+namespace {
+[[maybe_unused]] bool const sorter_matrix_registered = register_sorter_matrix(
+  all_key_types{},
+  shape_list<DataShape::random, DataShape::nearly_sorted, DataShape::descending>{},
+  type_list<cppsort::std_sorter, cppsort::pdq_sorter, cppsort::ska_sorter, cppsort::spread_sorter, cppsort::merge_sorter, cppsort::drop_merge_sorter, cppsort::split_sorter,
+            cppsort::tim_sorter, cppsort::verge_sorter>{});
+} // namespace
 
-// string -> int
-BASELINE_F(STRING_INT, Baseline, SharedDataFixture, 30, 1) {
-  loop_string_number_baseline(this->shared_data);
-}
-BENCHMARK_F(STRING_INT, 01_STD_MAP, SharedDataFixture, 30, 1) {
-  loop_string_number<std::map<std::string, int>>(this->shared_data);
-}
-BENCHMARK_F(STRING_INT, 02_STD_FLAT_MAP, SharedDataFixture, 30, 1) {
-  loop_string_number<std::flat_map<std::string, int>>(this->shared_data);
-}
-BENCHMARK_F(STRING_INT, 03_ABSEIL_BTREE, SharedDataFixture, 30, 1) {
-  loop_string_number<absl::btree_map<std::string, int>>(this->shared_data);
-}
-BENCHMARK_F(STRING_INT, 04_ARRAY, SharedDataFixture, 30, 1) {
-  loop_string_number_array<std::string, int>(this->shared_data);
-}
-BENCHMARK_F(STRING_INT, 05_ARRAY_CPPSORT, SharedDataFixture, 30, 1) {
-  loop_string_number_array_cppsort<std::string, int>(this->shared_data);
-}
+// sort_by_keyの自動選択と固定した各実装の比較 (キー型 x 並び方)
+namespace {
+[[maybe_unused]] bool const auto_matrix_registered = register_auto_matrix(all_key_types{});
+} // namespace
 
-// string -> string
-BASELINE_F(STRING_STRING, Baseline, SharedDataFixture, 30, 1) {
-  loop_string_string_baseline(this->shared_data);
-}
-BENCHMARK_F(STRING_STRING, 01_STD_MAP, SharedDataFixture, 30, 1) {
-  loop_string_string<std::map<std::string, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(STRING_STRING, 02_STD_FLAT_MAP, SharedDataFixture, 30, 1) {
-  loop_string_string<std::flat_map<std::string, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(STRING_STRING, 03_ABSEIL_BTREE, SharedDataFixture, 30, 1) {
-  loop_string_string<absl::btree_map<std::string, std::string const*>>(this->shared_data);
-}
-BENCHMARK_F(STRING_STRING, 04_ARRAY, SharedDataFixture, 30, 1) {
-  loop_string_string_array<std::string, std::string const*>(this->shared_data);
-}
-BENCHMARK_F(STRING_STRING, 05_ARRAY_CPPSORT, SharedDataFixture, 30, 1) {
-  loop_string_string_array_cppsort<std::string, std::string const*>(this->shared_data);
-}
+// 逐次実行とパイプライン実行の比較 (最初の結果までの時間はfirst_result_usに出力する)
+namespace {
+[[maybe_unused]] bool const pipeline_matrix_registered = register_pipeline_matrix(all_key_types{});
+} // namespace
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sort_by_key.h"
+
+/**
+ * @brief 行を塊ごとに受け取りながらソートするパイプライン
+ *
+ * 生産スレッド -> 整列スレッド -> 呼び出し元スレッド(マージ) の3段で動かす。
+ * 各段を別スレッドにするのは、生産・整列・マージを並列に進めて時間を重ねるため。
+ * std::generatorのコルーチンで組むと、各段は呼び出し元スレッドで交互に進むだけで計算は重ならない。
+ */
+namespace sort_by_map {
+
+/**
+ * @brief 容量付きのスレッド間キュー
+ *
+ * close()後は、残っている要素を取り出し終えるとpop()がnulloptを返す。
+ * close()後のpush()は要素を捨ててfalseを返す。
+ */
+template<typename T>
+class channel {
+public:
+  explicit channel(std::size_t capacity) : capacity_{capacity} {}
+
+  bool push(T value) {
+    auto lock = std::unique_lock{mutex_};
+    not_full_.wait(lock, [&] { return queue_.size() < capacity_ or closed_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push_back(std::move(value));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  std::optional<T> pop() {
+    auto lock = std::unique_lock{mutex_};
+    not_empty_.wait(lock, [&] { return not queue_.empty() or closed_; });
+    if (queue_.empty()) {
+      return std::nullopt;
+    }
+    auto value = std::move(queue_.front());
+    queue_.pop_front();
+    not_full_.notify_one();
+    return value;
+  }
+
+  void close() {
+    auto const lock = std::lock_guard{mutex_};
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+private:
+  std::size_t capacity_;
+  std::deque<T> queue_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  bool closed_ = false;
+};
+
+namespace detail {
+  // スコープを抜けるとき(例外による巻き戻しを含む)に関数を呼ぶ
+  template<typename F>
+  class scope_exit {
+  public:
+    explicit scope_exit(F f) : f_{std::move(f)} {}
+    ~scope_exit() { f_(); }
+
+    scope_exit(scope_exit const&) = delete;
+    scope_exit& operator=(scope_exit const&) = delete;
+
+  private:
+    F f_;
+  };
+} // namespace detail
+
+// キー列と値列の組 (整列前の塊、整列済みの列の両方に使う)
+template<typename Key, typename Value>
+struct row_chunk {
+  std::vector<Key> keys;
+  std::vector<Value> values;
+};
+
+/**
+ * @brief 整列済みの列をトーナメント木でマージする
+ *
+ * 列は到着順にadd_run()で追加できる。pop()は全体で最小の要素を1つずつ取り出す。
+ * 後から追加される列にさらに小さい要素があり得るので、全体の順序が必要なら全列を追加し終えてから取り出す。
+ * 同じキーは先に追加された列のものから取り出す。
+ */
+template<typename Key, typename Value>
+class tournament_merge {
+public:
+  void add_run(row_chunk<Key, Value> run) {
+    if (run.keys.empty()) {
+      return;
+    }
+    runs_.push_back(std::move(run));
+    positions_.push_back(0);
+    built_ = false;
+  }
+
+  // 次の要素を visitor(key, value) に渡す。残りがなければfalseを返す
+  template<typename Visitor>
+  bool pop(Visitor&& visitor) {
+    if (not built_) {
+      build();
+    }
+    auto const winner = tree_[1];
+    if (winner == none) {
+      return false;
+    }
+
+    auto& position = positions_[winner];
+    visitor(runs_[winner].keys[position], runs_[winner].values[position]);
+    ++position;
+    replay(winner);
+    return true;
+  }
+
+private:
+  static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+
+  std::size_t leaf_of(std::size_t run) const noexcept { return positions_[run] < runs_[run].keys.size() ? run : none; }
+
+  std::size_t winner_of(std::size_t lhs, std::size_t rhs) const {
+    if (lhs == none) {
+      return rhs;
+    }
+    if (rhs == none) {
+      return lhs;
+    }
+    auto const compare = key_less<Key>{};
+    return compare(runs_[rhs].keys[positions_[rhs]], runs_[lhs].keys[positions_[lhs]]) ? rhs : lhs;
+  }
+
+  // 葉の数を2のべき乗にそろえ、下から勝者を決める。O(列数)
+  void build() {
+    leaves_ = std::bit_ceil(std::max<std::size_t>(runs_.size(), 1));
+    tree_.assign(2 * leaves_, none);
+    for (auto run = std::size_t{0}; run < runs_.size(); ++run) {
+      tree_[leaves_ + run] = leaf_of(run);
+    }
+    for (auto node = leaves_ - 1; node >= 1; --node) {
+      tree_[node] = winner_of(tree_[2 * node], tree_[2 * node + 1]);
+    }
+    built_ = true;
+  }
+
+  // 取り出した列の葉から根までの勝者を決め直す。O(log 列数)
+  void replay(std::size_t run) {
+    auto node = leaves_ + run;
+    tree_[node] = leaf_of(run);
+    for (node /= 2; node >= 1; node /= 2) {
+      tree_[node] = winner_of(tree_[2 * node], tree_[2 * node + 1]);
+    }
+  }
+
+  std::vector<row_chunk<Key, Value>> runs_;
+  std::vector<std::size_t> positions_;
+  std::vector<std::size_t> tree_;  // tree_[1]が根、tree_[leaves_ + i]が列iの葉
+  std::size_t leaves_ = 0;
+  bool built_ = false;
+};
+
+/**
+ * @brief 行を塊ごとに受け取りながらソートし、キーの順に visitor(key, value) を呼び出す
+ *
+ * produce(emit) は生産スレッドで呼ばれ、emit(keys, values) で塊を1つずつ渡す。
+ * emitがfalseを返したら以降の塊は捨てられるので、produceはそこで生産をやめてよい。
+ * 各塊は整列スレッドで到着順にsort_by_keyで整列され、呼び出し元スレッドでトーナメント木に追加される。
+ * 最後の塊が届けば、残りはその塊の整列と木の構築だけで最初の結果を返せる。
+ * 生産・整列で投げられた例外は、両スレッドをjoinした後に呼び出し元で投げ直す。
+ * queue_depthは各段の間に溜められる塊の数。
+ */
+template<typename Key, typename Value, typename Producer, typename Visitor>
+void streaming_sort_by_key(Producer&& produce, Visitor&& visitor, calibration const& table = calibration{}, std::size_t queue_depth = 4) {
+  auto chunks = channel<row_chunk<Key, Value>>{queue_depth};
+  auto runs = channel<row_chunk<Key, Value>>{queue_depth};
+  auto const close_all = [&] {
+    chunks.close();
+    runs.close();
+  };
+
+  // 各スレッドが自分の段の例外だけを書き、読むのはjoinの後なのでロックは要らない
+  auto producer_error = std::exception_ptr{};
+  auto sorter_error = std::exception_ptr{};
+
+  // 破棄は宣言の逆順なので、呼び出し元で例外が出てもスレッドをjoinする前にキューが閉じられ、
+  // push()で待っているスレッドが抜けられる
+  auto producer = std::jthread{};
+  auto sorter = std::jthread{};
+  auto const close_channels = detail::scope_exit{close_all};
+
+  producer = std::jthread{[&] {
+    try {
+      produce([&](std::vector<Key> keys, std::vector<Value> values) { return chunks.push({std::move(keys), std::move(values)}); });
+      chunks.close();
+    } catch (...) {
+      producer_error = std::current_exception();
+      close_all();
+    }
+  }};
+
+  sorter = std::jthread{[&] {
+    try {
+      while (auto chunk = chunks.pop()) {
+        auto run = row_chunk<Key, Value>{};
+        run.keys.reserve(chunk->keys.size());
+        run.values.reserve(chunk->values.size());
+        sort_by_key(chunk->keys, chunk->values, [&](Key const& key, Value const& value) {
+          run.keys.push_back(key);
+          run.values.push_back(value);
+        }, table);
+        if (not runs.push(std::move(run))) {
+          break;
+        }
+      }
+      runs.close();
+    } catch (...) {
+      sorter_error = std::current_exception();
+      close_all();
+    }
+  }};
+
+  auto merge = tournament_merge<Key, Value>{};
+  while (auto run = runs.pop()) {
+    merge.add_run(std::move(*run));
+  }
+
+  producer.join();
+  sorter.join();
+  if (producer_error) {
+    std::rethrow_exception(producer_error);
+  }
+  if (sorter_error) {
+    std::rethrow_exception(sorter_error);
+  }
+
+  while (merge.pop(visitor)) {
+  }
+}
+
+} // namespace sort_by_map